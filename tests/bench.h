@@ -0,0 +1,77 @@
+/*********************************************************************
+This file is a part of FItsSec project: Implementation of ETSI TS 103 097
+Copyright (C) 2015  Denis Filatov (danya.filatov()gmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed under GNU GPLv3 in the hope that it will
+be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+@license GPL-3.0+ <http://www.gnu.org/licenses/gpl-3.0.txt>
+
+In particular cases this program can be distributed under other license
+by simple request to the author.
+*********************************************************************/
+#ifndef bench_h
+#define bench_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/** Latency samples of one benchmark stage (defined in utils.c) */
+typedef struct bench_stat_t {
+    const char * name;      //< stage name
+    uint64_t   * samples;   //< latencies in nanoseconds
+    size_t       count;     //< number of stored samples
+    size_t       size;      //< allocated size of the samples array
+    size_t       sorted;    //< number of samples already sorted
+    uint64_t     total;     //< sum of all samples
+    unsigned int errors;    //< count of failed operations
+} bench_stat_t;
+
+/** Monotonic time in nanoseconds */
+uint64_t bench_time_ns(void);
+
+void     bench_stat_init(bench_stat_t * s, const char * name, size_t size);
+void     bench_stat_free(bench_stat_t * s);
+void     bench_stat_add(bench_stat_t * s, uint64_t ns);
+
+/** Append all samples and errors of src to dst */
+void     bench_stat_merge(bench_stat_t * dst, const bench_stat_t * src);
+
+/** Return the latency for the given percentile (0..100).
+ *  Samples are sorted in place on the first call after bench_stat_add.
+ */
+uint64_t bench_stat_percentile(bench_stat_t * s, double p);
+
+/** Operations per second, based on the sum of sample latencies */
+double   bench_stat_throughput(const bench_stat_t * s);
+
+void     bench_stat_print_header(FILE * f);
+void     bench_stat_print(FILE * f, const char * label, bench_stat_t * s);
+
+/** Write stage results as a JSON object. No separator is written. */
+void     bench_stat_json(FILE * f, const char * label, bench_stat_t * s);
+
+/** Print latency histogram using power of 2 microsecond buckets */
+void     bench_stat_histogram(FILE * f, const char * label, const bench_stat_t * s);
+
+/** Error counters, indexed by the FSERR_ERROR() value of the status */
+#define BENCH_ERRORS_MAX 16
+typedef struct bench_errors_t {
+    unsigned int count[BENCH_ERRORS_MAX];
+} bench_errors_t;
+
+void     bench_errors_add(bench_errors_t * e, int status);
+void     bench_errors_merge(bench_errors_t * dst, const bench_errors_t * src);
+void     bench_errors_print(FILE * f, const char * label, const bench_errors_t * e);
+
+#endif
@@ -0,0 +1,344 @@
+/*********************************************************************
+This file is a part of FItsSec project: Implementation of ETSI TS 103 097
+Copyright (C) 2015  Denis Filatov (danya.filatov()gmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed under GNU GPLv3 in the hope that it will
+be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+@license GPL-3.0+ <http://www.gnu.org/licenses/gpl-3.0.txt>
+
+In particular cases this program can be distributed under other license
+by simple request to the author.
+*********************************************************************/
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "copts.h"
+#include "cstr.h"
+#include "cmem.h"
+#include "fitsec.h"
+#include "fitsec_error.h"
+#include "fitsec_time.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <inttypes.h>
+
+static FitSecConfig cfg;
+
+static FS3DLocation _position = { 514743600, 56248900, 0 };
+static FSTime64 _curTime = 0;
+static unsigned long _msg_count = 1000;
+static unsigned long _payload_size = 64;
+static float _rate = 10; // 10Hz
+
+// comma separated list of certificate pools in the form [label=]path
+// Use one pool per curve, for example: "nistp256=POOL_1,bp256=POOL_BP256,bp384=POOL_BP384".
+// 'make pool' creates only NIST P-256 pools. The test data has no Brainpool certificates,
+// so the Brainpool pools shall be provided by the user.
+char * _pools = "POOL_1";
+char * _outpath = "bench_fitsec.json";
+char * _curStrTime = NULL;
+
+static copt_t options [] = {
+    { "h?", "help",     COPT_HELP,     NULL,          "Print this help page"},
+    { "p",  "pools",    COPT_STR,      &_pools,       "Comma separated list of [label=]storage directories, one per curve. Brainpool pools are not created by 'make pool'" },
+    { "o",  "out",      COPT_STR,      &_outpath,     "JSON output path" },
+    { "t",  "time",     COPT_STR,      &_curStrTime,  "The ISO representation of starting time" },
+    { "r",  "rate",     COPT_FLOAT,    &_rate,        "Message rate in Hz" },
+    { "n",  "count",    COPT_ULONG,    &_msg_count,   "Message count" },
+    { "s",  "size",     COPT_ULONG,    &_payload_size,"Payload size in bytes" },
+
+    { NULL, NULL, COPT_END, NULL, NULL }
+};
+
+int loadCertificates(FitSec * e, FSTime32 curTime, const pchar_t * _path);
+int strpdate(const char* s, struct tm* t);                // defined in utils.c
+
+#define MAX_PAYLOAD_SIZE 1024
+
+static const FSItsAidSsp _aidSsp = { FITSEC_AID_CAM, 3, {{0x01, 0xFF, 0xFC}} };
+static char _payload[MAX_PAYLOAD_SIZE];
+
+static const char * _signed_stages[] = { "prepare", "sign", "parse", "validate" };
+static const char * _encrypted_stages[] = { "prepare", "encrypt", "parse", "decrypt" };
+
+static FILE * _json = NULL;
+static unsigned int _json_count = 0;
+
+static void _report(const char * label, bench_stat_t * st, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        bench_stat_print(stdout, label, &st[i]);
+        if (_json) {
+            fprintf(_json, "%s\n    ", _json_count++ ? "," : "");
+            bench_stat_json(_json, label, &st[i]);
+        }
+        bench_stat_free(&st[i]);
+    }
+}
+
+static void bench_signed(FitSec * e, const char * pool, FSSignerInfoType signerType)
+{
+    char buf[MAX_PAYLOAD_SIZE + 1024];
+    char label[64];
+    bench_stat_t st[4];
+    FSMessageInfo m, r;
+    uint64_t t;
+    size_t len;
+
+    for (int i = 0; i < 4; i++) {
+        bench_stat_init(&st[i], _signed_stages[i], _msg_count);
+    }
+
+    for (unsigned long i = 0; i < _msg_count; i++) {
+        memset(&m, 0, sizeof(m));
+        m.message = buf;
+        m.messageSize = sizeof(buf);
+        m.payloadType = FS_PAYLOAD_SIGNED;
+        m.position = _position;
+        m.generationTime = _curTime + (FSTime64)(1000000.0 * i / _rate);
+        m.sign.ssp = _aidSsp;
+        m.sign.signerType = signerType;
+
+        t = bench_time_ns();
+        len = FitSec_PrepareSignedMessage(e, &m);
+        if (len == 0 || m.sign.cert == NULL) {
+            st[0].errors++;
+            fprintf(stderr, "SEND %s %2lu:\t ERROR: 0x%08X %s\n", FitSec_Name(e), i, m.status, FitSec_ErrorMessage(m.status));
+            continue;
+        }
+        bench_stat_add(&st[0], bench_time_ns() - t);
+
+        m.payloadSize = _payload_size;
+        memcpy(m.payload, _payload, m.payloadSize);
+
+        t = bench_time_ns();
+        len = FitSec_FinalizeSignedMessage(e, &m);
+        if (len == 0) {
+            st[1].errors++;
+            fprintf(stderr, "SIGN %s %2lu:\t ERROR: 0x%08X %s\n", FitSec_Name(e), i, m.status, FitSec_ErrorMessage(m.status));
+            continue;
+        }
+        bench_stat_add(&st[1], bench_time_ns() - t);
+
+        memset(&r, 0, sizeof(r));
+        r.message = buf;
+        r.messageSize = len;
+        r.generationTime = m.generationTime;
+
+        t = bench_time_ns();
+        len = FitSec_ParseMessage(e, &r);
+        if (len == 0) {
+            st[2].errors++;
+            fprintf(stderr, "PARS %s %2lu:\t ERROR: 0x%08X %s\n", FitSec_Name(e), i, r.status, FitSec_ErrorMessage(r.status));
+            continue;
+        }
+        bench_stat_add(&st[2], bench_time_ns() - t);
+
+        t = bench_time_ns();
+        if (!FitSec_ValidateSignedMessage(e, &r)) {
+            st[3].errors++;
+            fprintf(stderr, "VALD %s %2lu:\t ERROR: 0x%08X %s\n", FitSec_Name(e), i, r.status, FitSec_ErrorMessage(r.status));
+            continue;
+        }
+        bench_stat_add(&st[3], bench_time_ns() - t);
+    }
+
+    snprintf(label, sizeof(label), "%s/%s", pool, signerType == FS_SI_DIGEST ? "digest" : "certificate");
+    _report(label, st, 4);
+}
+
+static void bench_encrypted(FitSec * e, const char * pool, bool psk)
+{
+    char buf[MAX_PAYLOAD_SIZE + 1024];
+    char label[64];
+    bench_stat_t st[4];
+    FSMessageInfo m, r;
+    FSHashedId8 recipient;
+    uint64_t t;
+    size_t len;
+    int error = 0;
+
+    if (psk) {
+        uint8_t key[16];
+        memset(key, 'a', sizeof(key));
+        recipient = FitSec_InstallPreSharedSymmKey(e, FS_AES_128_CCM, FSTime32from64(_curTime), key, 0);
+    }
+    else {
+        const FSCertificate * c = FitSec_CurrentCertificate(e, FITSEC_AID_CAM);
+        if (c == NULL) {
+            c = FitSec_SelectEECertificate(e, &_aidSsp, NULL, _curTime, &error);
+        }
+        if (c == NULL || FSCertificate_GetEncryptionKey(c) == NULL) {
+            fprintf(stderr, "%s: no AT certificate with encryption key, skip encryption benchmark\n", pool);
+            return;
+        }
+        recipient = FSCertificate_Digest(c);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        bench_stat_init(&st[i], _encrypted_stages[i], _msg_count);
+    }
+
+    for (unsigned long i = 0; i < _msg_count; i++) {
+        memset(&m, 0, sizeof(m));
+        m.message = buf;
+        m.messageSize = sizeof(buf);
+        m.payloadType = FS_PAYLOAD_ENCRYPTED;
+        m.position = _position;
+        m.generationTime = _curTime + (FSTime64)(1000000.0 * i / _rate);
+
+        t = bench_time_ns();
+        len = FitSec_PrepareEncryptedMessage(e, &m);
+        if (len) {
+            if (psk) {
+                len = FitSec_AddEncryptedMessagePSKReceipient(e, &m, FS_AES_128_CCM, NULL, recipient);
+            }
+            else {
+                len = FitSec_AddEncryptedMessageCertificateReceipient(e, &m, recipient);
+            }
+        }
+        if (len == 0) {
+            st[0].errors++;
+            fprintf(stderr, "SEND %s %2lu:\t ERROR: 0x%08X %s\n", FitSec_Name(e), i, m.status, FitSec_ErrorMessage(m.status));
+            continue;
+        }
+        bench_stat_add(&st[0], bench_time_ns() - t);
+
+        m.payloadSize = _payload_size;
+        memcpy(m.payload, _payload, m.payloadSize);
+
+        t = bench_time_ns();
+        len = FitSec_FinalizeEncryptedMessage(e, &m);
+        if (len == 0) {
+            st[1].errors++;
+            fprintf(stderr, "ENCR %s %2lu:\t ERROR: 0x%08X %s\n", FitSec_Name(e), i, m.status, FitSec_ErrorMessage(m.status));
+            continue;
+        }
+        bench_stat_add(&st[1], bench_time_ns() - t);
+
+        memset(&r, 0, sizeof(r));
+        r.message = buf;
+        r.messageSize = len;
+        r.generationTime = m.generationTime;
+
+        t = bench_time_ns();
+        len = FitSec_ParseMessage(e, &r);
+        if (len == 0) {
+            st[2].errors++;
+            fprintf(stderr, "PARS %s %2lu:\t ERROR: 0x%08X %s\n", FitSec_Name(e), i, r.status, FitSec_ErrorMessage(r.status));
+            continue;
+        }
+        bench_stat_add(&st[2], bench_time_ns() - t);
+
+        t = bench_time_ns();
+        if (0 == FitSec_DecryptMessage(e, &r)) {
+            st[3].errors++;
+            fprintf(stderr, "DECR %s %2lu:\t ERROR: 0x%08X %s\n", FitSec_Name(e), i, r.status, FitSec_ErrorMessage(r.status));
+            continue;
+        }
+        bench_stat_add(&st[3], bench_time_ns() - t);
+    }
+
+    snprintf(label, sizeof(label), "%s/%s", pool, psk ? "psk" : "certificate-enc");
+    _report(label, st, 4);
+}
+
+static int bench_pool(const char * label, const char * path)
+{
+    FitSec * e = FitSec_New(&cfg, label);
+    if (0 >= loadCertificates(e, FSTime32from64(_curTime), path)) {
+        fprintf(stderr, "%s: Load certificates failed\n", path);
+        FitSec_Free(e);
+        return -1;
+    }
+
+    bench_signed(e, label, FS_SI_DIGEST);
+    bench_signed(e, label, FS_SI_CERTIFICATE);
+    bench_encrypted(e, label, false);
+    bench_encrypted(e, label, true);
+
+    FitSec_Free(e);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    FitSecConfig_InitDefault(&cfg);
+    cfg.flags |= FS_ALLOW_CERT_DUPLICATIONS;
+
+    int flags = COPT_DEFAULT | COPT_NOERR_UNKNOWN | COPT_NOAUTOHELP;
+    argc = coptions(argc, argv, flags, options);
+    if (COPT_ERC(argc)) {
+        coptions_help(stdout, argv[0], 0, options, "Benchmark");
+        return -1;
+    }
+
+    if (_curStrTime) {
+        struct tm t;
+        if (0 > strpdate(_curStrTime, &t)) {
+            fprintf(stderr, "%s: Unknown time format\n", _curStrTime);
+            return -1;
+        }
+        _curTime = mkitstime64(&t);
+    }
+    else {
+        _curTime = unix2itstime64(time(NULL));
+    }
+
+    if (_payload_size > MAX_PAYLOAD_SIZE) {
+        _payload_size = MAX_PAYLOAD_SIZE;
+    }
+    for (size_t i = 0; i < sizeof(_payload); i++) {
+        _payload[i] = (char)(i & 0xFF);
+    }
+
+    if (_outpath && _outpath[0]) {
+        _json = fopen(_outpath, "w");
+        if (_json == NULL) {
+            perror(_outpath);
+            return -1;
+        }
+        fprintf(_json, "{\n  \"version\":\"%d.%d.%d\",\n  \"count\":%lu,\n  \"payload\":%lu,\n  \"results\":[",
+            FS_VERSION_RELEASE, FS_VERSION_MAJOR, FS_VERSION_MINOR, _msg_count, _payload_size);
+    }
+
+    bench_stat_print_header(stdout);
+
+    char * pools = cstrdup(_pools);
+    int rc = 0;
+    for (char * p = strtok(pools, ","); p; p = strtok(NULL, ",")) {
+        char * path = strchr(p, '=');
+        const char * label = p;
+        if (path) {
+            *path++ = 0;
+        }
+        else {
+            path = p;
+        }
+        if (bench_pool(label, path)) {
+            rc = -1;
+        }
+    }
+    free(pools);
+
+    if (_json) {
+        fprintf(_json, "\n  ]\n}\n");
+        fclose(_json);
+    }
+    FSMessageInfo_Cleanup();
+    return rc;
+}
@@ -0,0 +1,464 @@
+/*********************************************************************
+This file is a part of FItsSec project: Implementation of ETSI TS 103 097
+Copyright (C) 2015  Denis Filatov (danya.filatov()gmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed under GNU GPLv3 in the hope that it will
+be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+@license GPL-3.0+ <http://www.gnu.org/licenses/gpl-3.0.txt>
+
+In particular cases this program can be distributed under other license
+by simple request to the author.
+*********************************************************************/
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "copts.h"
+#include "cstr.h"
+#include "cmem.h"
+#include "fitsec.h"
+#include "fitsec_error.h"
+#include "fitsec_time.h"
+#include "fitsec_cert_db.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <inttypes.h>
+#ifdef WIN32
+#include <windows.h>
+#define sched_yield() SwitchToThread()
+void usleep(__int64 usec);
+#else
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+/* Load generator:
+ *  - N neighbour stations sign CAMs at the given rate. Each station is a separate engine,
+ *    loaded from one subdirectory of the stations pool, so each station has its own AT.
+ *    Every subdirectory is a storage like POOL_1: root, AA and AT certificates with the
+ *    AT .vkey/.ekey files. 'make pool' creates POOL_STATIONS with one subdirectory per
+ *    test AT in data/certificates issued by the AA of POOL_1. To simulate more stations,
+ *    issue more AT certificates by this AA and put each of them into its own subdirectory.
+ *    The tool fails when there are less subdirectories than stations. With -S stations
+ *    share the storages, but then the receiver sees only as many signers as storages.
+ *  - All messages are signed in advance by several generator threads,
+ *    so the signing cost does not affect the receiver.
+ *  - The local engine parses received messages and validates them using the async API,
+ *    either at the recorded rate (realtime) or as fast as possible.
+ */
+
+static FitSecConfig cfg_rcv, cfg_snd;
+
+static FS3DLocation _position = { 514743600, 56248900, 0 };
+static FSTime64 _curTime = 0;
+static unsigned int _station_count = 300;
+static unsigned int _duration = 10;      // seconds of simulated traffic
+static unsigned int _thread_count = 4;   // generator threads
+static unsigned int _cert_period = 1000; // ms between CAMs containing the AT certificate
+static float _rate = 10;                 // 10Hz
+static int   _realtime = 0;
+static int   _shared = 0;
+
+char * _storage = "POOL_1";
+char * _stations = "POOL_STATIONS";
+char * _curStrTime = NULL;
+
+static copt_t options [] = {
+    { "h?", "help",     COPT_HELP,     NULL,            "Print this help page"},
+    { "1",  "pool",     COPT_STR,      &_storage,       "Storage directory of the local station" },
+    { "s",  "stations", COPT_STR,      &_stations,      "Directory containing one storage subdirectory per neighbour station" },
+    { "n",  "count",    COPT_UINT,     &_station_count, "Neighbour station count" },
+    { "d",  "duration", COPT_UINT,     &_duration,      "Duration of the simulated traffic in seconds" },
+    { "j",  "threads",  COPT_UINT,     &_thread_count,  "Count of generator threads" },
+    { "c",  "cert",     COPT_UINT,     &_cert_period,   "Period in ms to send AT certificate instead of digest" },
+    { "r",  "rate",     COPT_FLOAT,    &_rate,          "CAM rate in Hz" },
+    { "R",  "realtime", COPT_BOOL,     &_realtime,      "Deliver messages at the generation rate" },
+    { "S",  "shared",   COPT_BOOL,     &_shared,        "Allow stations to share storages when there are less storages than stations" },
+    { "t",  "time",     COPT_STR,      &_curStrTime,    "The ISO representation of starting time" },
+
+    { NULL, NULL, COPT_END, NULL, NULL }
+};
+
+int loadCertificates(FitSec * e, FSTime32 curTime, const pchar_t * _path);
+int strpdate(const char* s, struct tm* t);                // defined in utils.c
+
+static FitSecAppProfile _Profiles[] = {
+    {	{FITSEC_AID_CAM,  3, {{ 0xFF }}}, FS_PAYLOAD_SIGNED, FS_FIELDS_CAM_DEFAULT, 1000, 0},
+    {	{FITSEC_AID_ANY,  0, {{ 0	 }}}, FS_PAYLOAD_SIGNED, FS_FIELDS_DEFAULT, 0, 0  }
+};
+
+static const FSItsAidSsp _aidSsp = { FITSEC_AID_CAM, 3, {{0x01, 0xFF, 0xFC}} };
+static char _defaultPayload[] = "1234567890";
+
+typedef struct Frame {
+    FSTime64 time;
+    size_t   len;
+    char   * data;
+} Frame;
+
+typedef struct Station {
+    FitSec * e;
+    char     name[16];
+} Station;
+
+static Station * _st = NULL;
+static Frame   * _frames = NULL;
+static size_t    _frame_count = 0;
+static unsigned int _slot_count = 0;
+
+static char ** _dirs = NULL;
+static unsigned int _dir_count = 0;
+
+static void _add_station_dir(const char * path, const char * name)
+{
+    char ** p = realloc(_dirs, (_dir_count + 1) * sizeof(char*));
+    if (p) {
+        _dirs = p;
+        _dirs[_dir_count] = malloc(strlen(path) + strlen(name) + 2);
+        sprintf(_dirs[_dir_count], "%s/%s", path, name);
+        _dir_count++;
+    }
+}
+
+/* collect station storage subdirectories */
+static int _load_station_dirs(const char * path)
+{
+#ifdef WIN32
+    WIN32_FIND_DATA fd;
+    HANDLE h;
+    char * mask = malloc(strlen(path) + 3);
+    sprintf(mask, "%s/*", path);
+    h = FindFirstFile(mask, &fd);
+    free(mask);
+    if (INVALID_HANDLE_VALUE != h) {
+        do {
+            if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && fd.cFileName[0] != '.') {
+                _add_station_dir(path, fd.cFileName);
+            }
+        } while (FindNextFile(h, &fd));
+        FindClose(h);
+    }
+#else
+    DIR * d = opendir(path);
+    if (d) {
+        struct dirent * de;
+        struct stat st;
+        char * sub = malloc(strlen(path) + 256 + 2);
+        while (NULL != (de = readdir(d))) {
+            if (de->d_name[0] != '.') {
+                sprintf(sub, "%s/%s", path, de->d_name);
+                if (0 == stat(sub, &st) && S_ISDIR(st.st_mode)) {
+                    _add_station_dir(path, de->d_name);
+                }
+            }
+        }
+        free(sub);
+        closedir(d);
+    }
+#endif
+    return _dir_count;
+}
+
+static void* g_thread(void* p)
+{
+    unsigned int tid = (unsigned int)(size_t)p;
+    char buf[1024];
+    FSTime64 period = (FSTime64)(1000000.0 / _rate);
+
+    for (unsigned int slot = 0; slot < _slot_count; slot++) {
+        for (unsigned int s = tid; s < _station_count; s += _thread_count) {
+            Frame * f = &_frames[((size_t)slot) * _station_count + s];
+            FSMessageInfo m = { 0 };
+            m.message = buf;
+            m.messageSize = sizeof(buf);
+            m.payloadType = FS_PAYLOAD_SIGNED;
+            m.position = _position;
+            m.sign.ssp = _aidSsp;
+            m.sign.signerType = FS_SI_AUTO;
+            // spread stations over the period
+            m.generationTime = _curTime + slot * period + (period * s) / _station_count;
+            // failed frames keep the time to not block the realtime delivery
+            f->time = m.generationTime;
+
+            if (0 == FitSec_PrepareSignedMessage(_st[s].e, &m)) {
+                fprintf(stderr, "SEND %s %2u:\t ERROR: 0x%08X %s\n", FitSec_Name(_st[s].e), slot, m.status, FitSec_ErrorMessage(m.status));
+                continue;
+            }
+            m.payloadSize = sizeof(_defaultPayload);
+            memcpy(m.payload, _defaultPayload, m.payloadSize);
+            size_t len = FitSec_FinalizeSignedMessage(_st[s].e, &m);
+            if (len == 0) {
+                fprintf(stderr, "SIGN %s %2u:\t ERROR: 0x%08X %s\n", FitSec_Name(_st[s].e), slot, m.status, FitSec_ErrorMessage(m.status));
+                continue;
+            }
+            f->data = malloc(len);
+            if (f->data) {
+                memcpy(f->data, buf, len);
+                f->len = len;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* receiver statistics */
+static unsigned long _enqueued = 0;
+static unsigned long _completed = 0;     // all finished validations, for queue bookkeeping
+static unsigned long _valid = 0;         // successful validations only
+static unsigned long _max_depth = 0;
+static uint64_t      _sum_depth = 0;
+static unsigned long _depth_samples = 0;
+static bench_errors_t _parse_errors;
+static bench_errors_t _vald_errors;
+static bench_stat_t  _queue_latency;
+static uint64_t    * _enqueue_time = NULL;
+
+static bool _onValidated(FitSec* e, void* user, FSEventId event, const FSEventParam* params)
+{
+    FSMessageInfo* m = (FSMessageInfo*)params;
+    // the async queue is processed in FIFO order,
+    // so the n-th callback corresponds to the n-th enqueued message.
+    bench_stat_add(&_queue_latency, bench_time_ns() - _enqueue_time[_completed]);
+    _completed++;
+    if (m->status != 0) {
+        bench_errors_add(&_vald_errors, m->status);
+        return false;
+    }
+    _valid++;
+    return true;
+}
+
+static bool _onEvent(FitSec* e, void* user, FSEventId event, const FSEventParam* params)
+{
+    return true;
+}
+
+static void _receive(FitSec * e, const Frame * f)
+{
+    FSMessageInfo * m = FSMessageInfo_Allocate(1024);
+    memcpy(m->message, f->data, f->len);
+    m->messageSize = f->len;
+    m->generationTime = f->time; // emulate current time
+    if (0 == FitSec_ParseMessage(e, m) || m->payloadType != FS_PAYLOAD_SIGNED) {
+        bench_errors_add(&_parse_errors, m->status ? m->status : FSERR_INVALID);
+        FSMessageInfo_Free(m);
+        return;
+    }
+    _enqueue_time[_enqueued] = bench_time_ns();
+    if (!FitSec_ValidateSignedMessageAsync(e, m, NULL)) {
+        bench_errors_add(&_vald_errors, m->status);
+        FSMessageInfo_Free(m);
+        return;
+    }
+    _enqueued++;
+}
+
+// count received AT certificates and the sum of their encoded sizes.
+// This is not the memory used by the pool, which is not reported by the library.
+static void _pool_usage(FitSec * e, unsigned int * count, size_t * encoded)
+{
+    *count = 0; *encoded = 0;
+    FSCertDB_ForEach(e, FSCERTDB_AT, c) {
+        size_t len = 0;
+        FSCertificate_Buffer((const FSCertificate*)c, &len);
+        *encoded += len;
+        (*count)++;
+    }
+}
+
+static void _sample_depth(void)
+{
+    unsigned long depth = _enqueued - _completed;
+    if (depth > _max_depth) _max_depth = depth;
+    _sum_depth += depth;
+    _depth_samples++;
+}
+
+int main(int argc, char** argv)
+{
+    FitSec * e;
+
+    FitSecConfig_InitDefault(&cfg_rcv);
+    FitSecConfig_InitDefault(&cfg_snd);
+
+    int flags = COPT_DEFAULT | COPT_NOERR_UNKNOWN | COPT_NOAUTOHELP;
+    argc = coptions(argc, argv, flags, options);
+    if (COPT_ERC(argc) || _station_count == 0 || _thread_count == 0 || _rate <= 0) {
+        coptions_help(stdout, argv[0], 0, options, "Load generator");
+        return -1;
+    }
+
+    if (_curStrTime) {
+        struct tm t;
+        if (0 > strpdate(_curStrTime, &t)) {
+            fprintf(stderr, "%s: Unknown time format\n", _curStrTime);
+            return -1;
+        }
+        _curTime = mkitstime64(&t);
+    }
+    else {
+        _curTime = unix2itstime64(time(NULL));
+    }
+
+    _Profiles[0].certPeriod = (int)_cert_period;
+    cfg_snd.appProfiles = &_Profiles[0];
+    cfg_snd.flags |= FS_ALLOW_CERT_DUPLICATIONS;
+
+    cfg_rcv.flags |= FS_ALLOW_CERT_DUPLICATIONS;
+    cfg_rcv.cbOnEvent = _onEvent;
+    cfg_rcv.cbOnValidated = _onValidated;
+
+    // create neighbour stations
+    if (0 == _load_station_dirs(_stations)) {
+        fprintf(stderr, "%s: no station storages found. Run 'make pool' or create one storage subdirectory per station\n", _stations);
+        return -1;
+    }
+    if (_dir_count < _station_count) {
+        if (!_shared) {
+            fprintf(stderr, "%s: %u storages for %u stations. Create more storages, reduce the station count or use -S\n", _stations, _dir_count, _station_count);
+            return -1;
+        }
+        fprintf(stderr, "WARNING: %u stations share %u storages, the receiver sees only %u different signers\n", _station_count, _dir_count, _dir_count);
+    }
+    _st = calloc(_station_count, sizeof(Station));
+    for (unsigned int s = 0; s < _station_count; s++) {
+        sprintf(_st[s].name, "S%u", s);
+        _st[s].e = FitSec_New(&cfg_snd, _st[s].name);
+        if (0 >= loadCertificates(_st[s].e, FSTime32from64(_curTime), _dirs[s % _dir_count])) {
+            fprintf(stderr, "%s: Load certificates failed\n", _dirs[s % _dir_count]);
+            return -1;
+        }
+    }
+    fprintf(stderr, "%u stations created from %u storages\n", _station_count, _dir_count);
+
+    // sign all messages in advance
+    _slot_count = (unsigned int)(_duration * _rate);
+    _frame_count = ((size_t)_slot_count) * _station_count;
+    _frames = calloc(_frame_count, sizeof(Frame));
+    _enqueue_time = calloc(_frame_count, sizeof(uint64_t));
+    if (_frames == NULL || _enqueue_time == NULL) {
+        fprintf(stderr, "Not enough memory for %zu messages\n", _frame_count);
+        return -1;
+    }
+
+    uint64_t t0 = bench_time_ns();
+#ifdef WIN32
+    HANDLE * thr = calloc(_thread_count, sizeof(HANDLE));
+    for (unsigned int i = 0; i < _thread_count; i++) {
+        thr[i] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)g_thread, (void*)(size_t)i, 0, NULL);
+    }
+    for (unsigned int i = 0; i < _thread_count; i++) {
+        WaitForSingleObject(thr[i], INFINITE);
+        CloseHandle(thr[i]);
+    }
+#else
+    pthread_t * thr = calloc(_thread_count, sizeof(pthread_t));
+    for (unsigned int i = 0; i < _thread_count; i++) {
+        pthread_create(&thr[i], NULL, g_thread, (void*)(size_t)i);
+    }
+    for (unsigned int i = 0; i < _thread_count; i++) {
+        pthread_join(thr[i], NULL);
+    }
+#endif
+    free(thr);
+    fprintf(stderr, "%zu messages signed in %.3f sec using %u threads\n", _frame_count, (bench_time_ns() - t0) / 1e9, _thread_count);
+
+    for (unsigned int s = 0; s < _station_count; s++) {
+        FitSec_Free(_st[s].e);
+    }
+    free(_st);
+
+    // local station
+    e = FitSec_New(&cfg_rcv, "L");
+    if (0 >= loadCertificates(e, FSTime32from64(_curTime), _storage)) {
+        fprintf(stderr, "%s: Load certificates failed\n", _storage);
+        return -1;
+    }
+    bench_stat_init(&_queue_latency, "queue", _frame_count);
+
+    unsigned int pool_count = 0, pool_max_count = 0;
+    size_t pool_encoded = 0, pool_max_encoded = 0;
+    unsigned long last_valid = 0;
+    double min_rate = 0, max_rate = 0;
+    uint64_t last_second;
+
+    printf("%8s %10s %10s %10s %8s %10s %12s\n", "time,s", "received", "completed", "valid", "queue", "AT pool", "AT encoded");
+    t0 = last_second = bench_time_ns();
+    size_t i = 0;
+    unsigned int idle = 0;
+    while (i < _frame_count || (_completed < _enqueued && idle < 10000)) {
+        uint64_t now = bench_time_ns();
+        if (i < _frame_count && (!_realtime || (_frames[i].time - _curTime) * 1000 <= now - t0)) {
+            if (_frames[i].data) {
+                _receive(e, &_frames[i]);
+                _sample_depth();
+            }
+            i++;
+            if (_realtime) continue; // deliver all messages which are already due
+        }
+        if (FitSec_ProceedAsync(e)) {
+            idle = 0;
+        }
+        else if (_realtime || i == _frame_count) {
+            if (i == _frame_count) idle++;
+            usleep(50);
+        }
+        if (now - last_second >= 1000000000) {
+            double rate = (_valid - last_valid) * 1e9 / (now - last_second);
+            if (min_rate == 0 || rate < min_rate) min_rate = rate;
+            if (rate > max_rate) max_rate = rate;
+            _pool_usage(e, &pool_count, &pool_encoded);
+            if (pool_count > pool_max_count) pool_max_count = pool_count;
+            if (pool_encoded > pool_max_encoded) pool_max_encoded = pool_encoded;
+            printf("%8.1f %10zu %10lu %10lu %8lu %10u %12zu\n", (now - t0) / 1e9, i, _completed, _valid, _enqueued - _completed, pool_count, pool_encoded);
+            last_second = now;
+            last_valid = _valid;
+        }
+    }
+    uint64_t elapsed = bench_time_ns() - t0;
+    _pool_usage(e, &pool_count, &pool_encoded);
+    if (pool_count > pool_max_count) pool_max_count = pool_count;
+    if (pool_encoded > pool_max_encoded) pool_max_encoded = pool_encoded;
+
+    printf("\n");
+    printf("stations:             %u\n", _station_count);
+    printf("messages:             %zu in %.3f sec\n", _frame_count, elapsed / 1e9);
+    printf("completed:            %lu validations, %lu failed\n", _completed, _completed - _valid);
+    printf("validated:            %lu (%.1f msg/s, min %.1f, max %.1f per second)\n", _valid, _valid * 1e9 / elapsed, min_rate, max_rate);
+    printf("queue depth:          max %lu, mean %.1f\n", _max_depth, _depth_samples ? ((double)_sum_depth) / _depth_samples : 0.0);
+    printf("received AT pool:     max %u certificates, %zu bytes of encoded certificates\n", pool_max_count, pool_max_encoded);
+    printf("\n");
+    bench_stat_print_header(stdout);
+    bench_stat_print(stdout, "async", &_queue_latency);
+    bench_errors_print(stdout, "parse", &_parse_errors);
+    bench_errors_print(stdout, "validate", &_vald_errors);
+
+    bench_stat_free(&_queue_latency);
+    FitSec_Free(e);
+    for (i = 0; i < _frame_count; i++) {
+        free(_frames[i].data);
+    }
+    free(_frames);
+    free(_enqueue_time);
+    for (unsigned int d = 0; d < _dir_count; d++) {
+        free(_dirs[d]);
+    }
+    free(_dirs);
+    FSMessageInfo_Cleanup();
+    return 0;
+}
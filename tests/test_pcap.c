@@ -24,19 +24,42 @@ by simple request to the author.
 #include "cstr.h"
 #include "cbyteswap.h"
 #include "fitsec.h"
+#include "fitsec_error.h"
 #include "fitsec_time.h"
+#include "bench.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 #include <copts.h>
 #include <time.h>
 #include <pcap.h>
+#ifdef WIN32
+#include <windows.h>
+void usleep(__int64 usec);
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/* PCAP replay benchmark.
+ * Secured GeoNetworking packets are loaded from the capture files and then
+ * parsed and validated:
+ *   - in the main thread, as fast as possible or at the recorded rate (-R)
+ *   - or spread over several worker threads (-j). Each worker runs its own engine
+ *     with the same certificate storage. Packets are routed to workers by the sender
+ *     link-layer address (the MID part of the GN address), so the digest signed messages
+ *     are validated by the same engine which has received the sender AT certificate.
+ * Capture timestamps are used as the current time unless the time is set explicitly.
+ */
 
 static pchar_t* _o_cfgfile = NULL;
 char *          _o_storage = "POOL_PCAP";
 char *          _o_outpath  = "msg.log";
 char *          _o_curStrTime = NULL;
+static unsigned int _o_threads = 0;
+static int          _o_realtime = 0;
 
 static uint64_t     _curTime = 0;
 
@@ -49,6 +72,8 @@ static copt_t options [] = {
     { "1",  "pool",     COPT_STR,      &_o_storage,      "Storage directory"   },
     { "o",  "out",      COPT_STR,      &_o_outpath,      "Output path"         },
     { "t",  "time",     COPT_STR,      &_o_curStrTime,  "The ISO representation of starting time" },
+    { "j",  "threads",  COPT_UINT,     &_o_threads,      "Spread packets over given count of worker threads" },
+    { "R",  "realtime", COPT_BOOL,     &_o_realtime,     "Replay packets at the recorded rate" },
 
 
     { NULL, NULL, COPT_END, NULL, NULL }
@@ -56,16 +81,113 @@ static copt_t options [] = {
 
 static char _error_buffer[PCAP_ERRBUF_SIZE];
 
+typedef struct Packet {
+    FSTime64 time;      // capture time
+    uint32_t sender;    // hash of the sender link-layer address
+    size_t   len;
+    char   * data;      // secured packet, starting from the GN security header
+} Packet;
+
+static Packet * _packets = NULL;
+static size_t   _packet_count = 0;
+static size_t   _packet_size = 0;
+
+typedef struct Worker {
+    FitSec *       e;
+    unsigned int   id;
+    char           name[8];
+    bench_stat_t   parse;
+    bench_stat_t   validate;
+    bench_errors_t parse_errors;
+    bench_errors_t validate_errors;
+} Worker;
+
 static void my_packet_handler(
     uint8_t *args,
     const struct pcap_pkthdr *header,
     const uint8_t *packet
 );
 
+static void _process(Worker * w, const Packet * p)
+{
+    FSMessageInfo m = {0};
+    uint64_t t;
+
+    m.message = p->data;
+    m.messageSize = p->len;
+    m.generationTime = _curTime ? _curTime : p->time;
+
+    t = bench_time_ns();
+    if (0 == FitSec_ParseMessage(w->e, &m)) {
+        w->parse.errors++;
+        bench_errors_add(&w->parse_errors, m.status);
+        return;
+    }
+    bench_stat_add(&w->parse, bench_time_ns() - t);
+
+    if (m.payloadType != FS_PAYLOAD_SIGNED && m.payloadType != FS_PAYLOAD_SIGNED_EXTERNAL) {
+        return;
+    }
+
+    t = bench_time_ns();
+    if (!FitSec_ValidateSignedMessage(w->e, &m)) {
+        w->validate.errors++;
+        bench_errors_add(&w->validate_errors, m.status);
+        return;
+    }
+    bench_stat_add(&w->validate, bench_time_ns() - t);
+}
+
+static void* w_thread(void* p)
+{
+    Worker * w = (Worker*)p;
+    unsigned int wcount = _o_threads ? _o_threads : 1;
+    uint64_t t0 = bench_time_ns();
+
+    for (size_t i = 0; i < _packet_count; i++) {
+        if (_packets[i].sender % wcount != w->id) {
+            continue;
+        }
+        if (_o_realtime && _packets[i].time > _packets[0].time) {
+            uint64_t due = (_packets[i].time - _packets[0].time) * 1000;
+            uint64_t now = bench_time_ns() - t0;
+            if (due > now) {
+                usleep((due - now) / 1000);
+            }
+        }
+        _process(w, &_packets[i]);
+    }
+    return NULL;
+}
+
+static int _worker_init(Worker * w, unsigned int id, const FitSecConfig * cfg)
+{
+    memset(w, 0, sizeof(*w));
+    w->id = id;
+    sprintf(w->name, "%u", id + 1);
+    bench_stat_init(&w->parse, "parse", _packet_count);
+    bench_stat_init(&w->validate, "validate", _packet_count);
+    w->e = FitSec_New(cfg, w->name);
+    if (0 >= loadCertificates(w->e, FSTime32from64(_curTime ? _curTime : _packets[0].time), _o_storage)) {
+        FitSec_Free(w->e);
+        w->e = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static void _worker_free(Worker * w)
+{
+    if (w->e) {
+        FitSec_Free(w->e);
+    }
+    bench_stat_free(&w->parse);
+    bench_stat_free(&w->validate);
+}
+
 int main(int argc, char** argv)
 {
     FitSecConfig cfg;
-    FitSec * e;
 
 #ifdef _MSC_VER
     SetDllDirectory("C:\\Windows\\System32\\Npcap\\");
@@ -79,23 +201,13 @@ int main(int argc, char** argv)
         return -1;
     }
 
-    e = FitSec_New(&cfg, "1");
-
     if(_o_curStrTime){
         struct tm t;
         if(0 > strpdate(_o_curStrTime, &t)){
             fprintf(stderr, "%s: Unknown time format\n", _o_curStrTime);
             return -1;
         }
-        _curTime = mkitstime32(&t);
-    }else{
-        _curTime = unix2itstime64(time(NULL));
-    }
-
-    if( 0 >= loadCertificates(e, _curTime, _o_storage)){
-	FitSec_Free(e);
-        fprintf(stderr, "Load certificates failed\n");
-        return 1;
+        _curTime = mkitstime64(&t);
     }
 
     for (int i=1; i<argc; i++) {
@@ -105,10 +217,81 @@ int main(int argc, char** argv)
             continue;
         }
         
-        pcap_loop(handle, 0, my_packet_handler, (uint8_t*)e);
+        pcap_loop(handle, 0, my_packet_handler, NULL);
+        pcap_close(handle);
+    }
+    if (_packet_count == 0) {
+        fprintf(stderr, "No secured GN packets found\n");
+        return 1;
     }
 
-    FitSec_Free(e);
+    unsigned int wcount = _o_threads ? _o_threads : 1;
+    Worker * w = calloc(wcount, sizeof(Worker));
+    for (unsigned int i = 0; i < wcount; i++) {
+        if (_worker_init(&w[i], i, &cfg)) {
+            fprintf(stderr, "Load certificates failed\n");
+            while (i) _worker_free(&w[--i]);
+            free(w);
+            return 1;
+        }
+    }
+
+    uint64_t t0 = bench_time_ns();
+    if (_o_threads == 0) {
+        w_thread(&w[0]);
+    }
+    else {
+#ifdef WIN32
+        HANDLE * thr = calloc(wcount, sizeof(HANDLE));
+        for (unsigned int i = 0; i < wcount; i++) {
+            thr[i] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)w_thread, &w[i], 0, NULL);
+        }
+        for (unsigned int i = 0; i < wcount; i++) {
+            WaitForSingleObject(thr[i], INFINITE);
+            CloseHandle(thr[i]);
+        }
+#else
+        pthread_t * thr = calloc(wcount, sizeof(pthread_t));
+        for (unsigned int i = 0; i < wcount; i++) {
+            pthread_create(&thr[i], NULL, w_thread, &w[i]);
+        }
+        for (unsigned int i = 0; i < wcount; i++) {
+            pthread_join(thr[i], NULL);
+        }
+#endif
+        free(thr);
+    }
+    uint64_t elapsed = bench_time_ns() - t0;
+
+    // merge results of all workers into the first one
+    for (unsigned int i = 1; i < wcount; i++) {
+        bench_stat_merge(&w[0].parse, &w[i].parse);
+        bench_stat_merge(&w[0].validate, &w[i].validate);
+        bench_errors_merge(&w[0].parse_errors, &w[i].parse_errors);
+        bench_errors_merge(&w[0].validate_errors, &w[i].validate_errors);
+    }
+
+    printf("\n%zu packets in %.3f sec (%.1f pkt/s) using %u thread(s)\n\n",
+        _packet_count, elapsed / 1e9, _packet_count * 1e9 / elapsed, wcount);
+    bench_stat_print_header(stdout);
+    bench_stat_print(stdout, "pcap", &w[0].parse);
+    bench_stat_print(stdout, "pcap", &w[0].validate);
+    printf("\n");
+    bench_stat_histogram(stdout, "pcap", &w[0].parse);
+    bench_stat_histogram(stdout, "pcap", &w[0].validate);
+    printf("\n");
+    bench_errors_print(stdout, "parse", &w[0].parse_errors);
+    bench_errors_print(stdout, "validate", &w[0].validate_errors);
+
+    for (unsigned int i = 0; i < wcount; i++) {
+        _worker_free(&w[i]);
+    }
+    free(w);
+    for (size_t i = 0; i < _packet_count; i++) {
+        free(_packets[i].data);
+    }
+    free(_packets);
+    FSMessageInfo_Cleanup();
     return 0;
 }
 
@@ -131,32 +314,49 @@ __PACKED__(struct EtherHeader
     uint8_t   next;
 });
 
+// FNV-1a hash of the MAC address
+static uint32_t _sender_hash(const uint8_t * mac)
+{
+    uint32_t h = 2166136261U;
+    for (int i = 0; i < 6; i++) {
+        h = (h ^ mac[i]) * 16777619U;
+    }
+    return h;
+}
+
 static void my_packet_handler(
     uint8_t *args,
     const struct pcap_pkthdr *header,
     const uint8_t *packet
 )
 {
-    FitSec * e = (FitSec *)args;
-
     const EtherHeader * eth_header = (const EtherHeader*) packet;
     if (eth_header->type == 0x4789) { // GN inverted
         const GN_BasicHeader * gnbh = (const GN_BasicHeader *)&eth_header->next;
         if((gnbh->ver_next & 0x0f) == 0x02) {
             // secured header
-            FSMessageInfo m = {0};
-//            memset(&m, 0, sizeof(m));
-            m.message = (char*)&gnbh->next;
-            m.messageSize = header->caplen - (m.message - (char*)packet);
-            m.generationTime = _curTime;
-
-            size_t rc = FitSec_ParseMessage(e, &m);
-            if(rc >=0){
-                if(FitSec_ValidateSignedMessage(e, &m)){
+            const uint8_t * sh = &gnbh->next;
+            if (header->caplen <= (size_t)(sh - packet)) {
+                return;
+            }
+            if (_packet_count == _packet_size) {
+                size_t size = _packet_size ? _packet_size * 2 : 1024;
+                Packet * p = realloc(_packets, size * sizeof(Packet));
+                if (p == NULL) {
                     return;
                 }
+                _packets = p;
+                _packet_size = size;
+            }
+            Packet * p = &_packets[_packet_count];
+            p->len = header->caplen - (sh - packet);
+            p->data = malloc(p->len);
+            if (p->data) {
+                memcpy(p->data, sh, p->len);
+                p->sender = _sender_hash(eth_header->shost);
+                p->time = unix2itstime64(header->ts.tv_sec) + header->ts.tv_usec;
+                _packet_count++;
             }
-            fprintf(stderr, "error: %s\n", FitSec_ErrorMessage(m.status));
         }
     }
 }
@@ -63,3 +63,223 @@ int timeval_subtract(struct timeval *result, struct timeval *x, struct timeval *
   return result->tv_sec < 0;
 }
 #endif
+
+#include "bench.h"
+#include <stdlib.h>
+#ifndef WIN32
+#include <time.h>
+#endif
+
+uint64_t bench_time_ns(void)
+{
+#ifdef WIN32
+    static LARGE_INTEGER freq = { 0 };
+    LARGE_INTEGER c;
+    if (freq.QuadPart == 0) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&c);
+    return ((uint64_t)(c.QuadPart / freq.QuadPart)) * 1000000000 +
+           ((uint64_t)(c.QuadPart % freq.QuadPart)) * 1000000000 / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+void bench_stat_init(bench_stat_t * s, const char * name, size_t size)
+{
+    memset(s, 0, sizeof(*s));
+    s->name = name;
+    if (size) {
+        s->samples = malloc(size * sizeof(uint64_t));
+        if (s->samples) {
+            s->size = size;
+        }
+    }
+}
+
+void bench_stat_free(bench_stat_t * s)
+{
+    free(s->samples);
+    s->samples = NULL;
+    s->size = s->count = s->sorted = 0;
+}
+
+void bench_stat_add(bench_stat_t * s, uint64_t ns)
+{
+    if (s->count == s->size) {
+        size_t size = s->size ? s->size * 2 : 1024;
+        uint64_t * p = realloc(s->samples, size * sizeof(uint64_t));
+        if (p == NULL) {
+            return;
+        }
+        s->samples = p;
+        s->size = size;
+    }
+    s->samples[s->count++] = ns;
+    s->total += ns;
+}
+
+void bench_stat_merge(bench_stat_t * dst, const bench_stat_t * src)
+{
+    for (size_t i = 0; i < src->count; i++) {
+        bench_stat_add(dst, src->samples[i]);
+    }
+    dst->errors += src->errors;
+}
+
+static int _u64cmp(const void * a, const void * b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+uint64_t bench_stat_percentile(bench_stat_t * s, double p)
+{
+    if (s->count == 0) {
+        return 0;
+    }
+    if (s->sorted != s->count) {
+        qsort(s->samples, s->count, sizeof(uint64_t), _u64cmp);
+        s->sorted = s->count;
+    }
+    size_t i = (size_t)(p * s->count / 100.0);
+    if (i >= s->count) {
+        i = s->count - 1;
+    }
+    return s->samples[i];
+}
+
+double bench_stat_throughput(const bench_stat_t * s)
+{
+    if (s->total == 0) {
+        return 0.0;
+    }
+    return 1000000000.0 * s->count / s->total;
+}
+
+void bench_stat_print_header(FILE * f)
+{
+    fprintf(f, "%-24s %-10s %8s %6s %10s %10s %10s %10s %10s %10s %12s\n",
+        "label", "stage", "count", "errors",
+        "mean,us", "p50,us", "p90,us", "p99,us", "p99.9,us", "max,us", "msg/s");
+}
+
+void bench_stat_print(FILE * f, const char * label, bench_stat_t * s)
+{
+    fprintf(f, "%-24s %-10s %8zu %6u %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %12.1f\n",
+        label, s->name, s->count, s->errors,
+        s->count ? s->total / 1000.0 / s->count : 0.0,
+        bench_stat_percentile(s, 50.0) / 1000.0,
+        bench_stat_percentile(s, 90.0) / 1000.0,
+        bench_stat_percentile(s, 99.0) / 1000.0,
+        bench_stat_percentile(s, 99.9) / 1000.0,
+        bench_stat_percentile(s, 100.0) / 1000.0,
+        bench_stat_throughput(s));
+}
+
+// write the string as a JSON string literal
+static void _json_string(FILE * f, const char * s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fputc('\\', f);
+            fputc(c, f);
+        }
+        else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        }
+        else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+void bench_stat_json(FILE * f, const char * label, bench_stat_t * s)
+{
+    fprintf(f, "{\"label\":");
+    _json_string(f, label);
+    fprintf(f, ",\"stage\":");
+    _json_string(f, s->name);
+    fprintf(f, ",\"count\":%zu,\"errors\":%u,"
+               "\"mean_ns\":%.0f,\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu,"
+               "\"throughput\":%.1f}",
+        s->count, s->errors,
+        s->count ? ((double)s->total) / s->count : 0.0,
+        (unsigned long long)bench_stat_percentile(s, 50.0),
+        (unsigned long long)bench_stat_percentile(s, 90.0),
+        (unsigned long long)bench_stat_percentile(s, 99.0),
+        (unsigned long long)bench_stat_percentile(s, 99.9),
+        (unsigned long long)bench_stat_percentile(s, 100.0),
+        bench_stat_throughput(s));
+}
+
+#define BENCH_HISTOGRAM_SIZE 32
+#define BENCH_HISTOGRAM_BAR  50
+
+void bench_stat_histogram(FILE * f, const char * label, const bench_stat_t * s)
+{
+    size_t buckets[BENCH_HISTOGRAM_SIZE] = { 0 };
+    size_t max = 0;
+    int first = BENCH_HISTOGRAM_SIZE, last = -1;
+
+    for (size_t i = 0; i < s->count; i++) {
+        uint64_t us = s->samples[i] / 1000;
+        int b = 0;
+        while (us > 1 && b < BENCH_HISTOGRAM_SIZE - 1) {
+            us >>= 1;
+            b++;
+        }
+        buckets[b]++;
+    }
+    for (int b = 0; b < BENCH_HISTOGRAM_SIZE; b++) {
+        if (buckets[b]) {
+            if (b < first) first = b;
+            last = b;
+            if (buckets[b] > max) max = buckets[b];
+        }
+    }
+    fprintf(f, "%s %s latency histogram (%zu samples):\n", label, s->name, s->count);
+    for (int b = first; b <= last; b++) {
+        int len = (int)(buckets[b] * BENCH_HISTOGRAM_BAR / max);
+        fprintf(f, "  %8llu - %8llu us %8zu %6.2f%% ",
+            b ? (1ULL << b) : 0ULL, (2ULL << b) - 1, buckets[b], 100.0 * buckets[b] / s->count);
+        while (len--) fputc('#', f);
+        fputc('\n', f);
+    }
+}
+
+#include "fitsec_error.h"
+
+static const char * _bench_error_names[BENCH_ERRORS_MAX] = {
+    "OK", "NOT_IMPLEMENTED", "PARSEERROR", "NOSPACE",
+    "INVALID", "UNKNOWN", "UNTRUSTED", "GEN_ERROR",
+    "NOT_YET_VALID", "UNSUPPORTED", "EVAL_EXPIRED", "NOT_FOUND",
+    "OTHER", "13", "14", "15"
+};
+
+void bench_errors_add(bench_errors_t * e, int status)
+{
+    e->count[FSERR_ERROR(status)]++;
+}
+
+void bench_errors_merge(bench_errors_t * dst, const bench_errors_t * src)
+{
+    for (int i = 0; i < BENCH_ERRORS_MAX; i++) {
+        dst->count[i] += src->count[i];
+    }
+}
+
+void bench_errors_print(FILE * f, const char * label, const bench_errors_t * e)
+{
+    for (int i = 1; i < BENCH_ERRORS_MAX; i++) {
+        if (e->count[i]) {
+            fprintf(f, "%-24s FSERR_%-16s %8u\n", label, _bench_error_names[i], e->count[i]);
+        }
+    }
+}